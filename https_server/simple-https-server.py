@@ -5,18 +5,192 @@
 #    python simple-https-server.py
 # then in your browser, visit:
 #    https://localhost:4443
+# add --no-ranges to serve whole files only, without Accept-Ranges, to test
+# clients which must fall back to a single stream.
+# add --max-rate N to answer 429 to requests beyond N per second, as SEC does.
+# add --delay S to hold every request for S seconds and --max-in-flight N to
+# answer 503 while more than N requests are being served, to test clients
+# which adapt their concurrency.
+# add --stall-every N to hold every Nth request for --stall-seconds (default 30)
+# to test clients which retry or hedge slow requests.
 
+import argparse
+import collections
 import http.server
-import socketserver
+import os
+import re
+import shutil
 import ssl
+import threading
+import time
 
 PORT = 8443
 CERT = "/home/dpriedel/projects/github/CollectEDGARData_Test/https_server/server.pem"
 
-Handler = http.server.SimpleHTTPRequestHandler
 
-server = socketserver.TCPServer(("localhost", PORT), Handler)
-server.socket = ssl.wrap_socket(server.socket, certfile=CERT, server_side=True)
+class Handler(http.server.SimpleHTTPRequestHandler):
+    # speak HTTP/1.1 so clients can keep a connection open and reuse it
+    # for many requests instead of paying a new TCP + TLS handshake each time.
+    protocol_version = "HTTP/1.1"
+    serve_ranges = True
+
+    # requests seen in the last second, across all connections.
+    max_rate = 0
+    recent_requests = collections.deque()
+    rate_lock = threading.Lock()
+
+    delay = 0.0
+    max_in_flight = 0
+    in_flight = 0
+    in_flight_lock = threading.Lock()
+
+    stall_every = 0
+    stall_seconds = 30.0
+    requests_served = 0
+
+    def do_GET(self):
+        self.serve(super().do_GET)
+
+    def do_HEAD(self):
+        self.serve(super().do_HEAD)
+
+    def serve(self, method):
+        with self.in_flight_lock:
+            Handler.in_flight += 1
+            Handler.requests_served += 1
+            stall = self.stall_every and self.requests_served % self.stall_every == 0
+        try:
+            time.sleep(self.stall_seconds if stall else self.delay)
+            method()
+        finally:
+            with self.in_flight_lock:
+                Handler.in_flight -= 1
+
+    # files carry an ETag built from their mtime and size. A matching
+    # If-None-Match gets a 304 with no body. If-Modified-Since is already
+    # handled by the base class, which ignores it when If-None-Match is present.
+    #
+    # a single 'Range: bytes=first-last' (either end may be omitted) gets a 206
+    # so clients can resume a partial download. An If-Range which no longer
+    # matches the ETag or Last-Modified means the file changed: send all of it.
+    def send_head(self):
+        self.etag = None
+        self.remaining = None
+        if self.over_rate_limit():
+            self.send_response(http.HTTPStatus.TOO_MANY_REQUESTS)
+            self.send_header("Retry-After", "1")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None
+        if self.max_in_flight and self.in_flight > self.max_in_flight:
+            self.send_response(http.HTTPStatus.SERVICE_UNAVAILABLE)
+            self.send_header("Retry-After", "1")
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None
+        path = self.translate_path(self.path)
+        if os.path.isfile(path):
+            st = os.stat(path)
+            self.etag = '"%x-%x"' % (st.st_mtime_ns, st.st_size)
+            tags = [t.strip() for t in self.headers.get("If-None-Match", "").split(",")]
+            if self.etag in tags or "*" in tags:
+                self.send_response(http.HTTPStatus.NOT_MODIFIED)
+                self.end_headers()
+                return None
+            byte_range = self.serve_ranges and self.requested_range(st)
+            if byte_range:
+                return self.send_range(path, st, *byte_range)
+        return super().send_head()
+
+    def over_rate_limit(self):
+        if not self.max_rate:
+            return False
+        now = time.monotonic()
+        with self.rate_lock:
+            while self.recent_requests and now - self.recent_requests[0] >= 1.0:
+                self.recent_requests.popleft()
+            if len(self.recent_requests) >= self.max_rate:
+                return True
+            self.recent_requests.append(now)
+        return False
+
+    def requested_range(self, st):
+        match = re.fullmatch(r"bytes=(\d*)-(\d*)", self.headers.get("Range", "").strip())
+        if not match or match.group(1) == match.group(2) == "":
+            return None
+        if_range = self.headers.get("If-Range")
+        if if_range and if_range not in (self.etag, self.date_time_string(st.st_mtime)):
+            return None
+        if match.group(1) == "":
+            first = max(st.st_size - int(match.group(2)), 0)
+            last = st.st_size - 1
+        else:
+            first = int(match.group(1))
+            last = st.st_size - 1
+            if match.group(2):
+                if int(match.group(2)) < first:
+                    return None
+                last = min(int(match.group(2)), last)
+        return first, last
+
+    def send_range(self, path, st, first, last):
+        if first > last:
+            self.send_response(http.HTTPStatus.REQUESTED_RANGE_NOT_SATISFIABLE)
+            self.send_header("Content-Range", "bytes */%d" % st.st_size)
+            self.send_header("Content-Length", "0")
+            self.end_headers()
+            return None
+        f = open(path, "rb")
+        f.seek(first)
+        self.remaining = last - first + 1
+        self.send_response(http.HTTPStatus.PARTIAL_CONTENT)
+        self.send_header("Content-type", self.guess_type(path))
+        self.send_header("Content-Range", "bytes %d-%d/%d" % (first, last, st.st_size))
+        self.send_header("Content-Length", str(self.remaining))
+        self.send_header("Last-Modified", self.date_time_string(st.st_mtime))
+        self.end_headers()
+        return f
+
+    def copyfile(self, source, outputfile):
+        if self.remaining is None:
+            return super().copyfile(source, outputfile)
+        while self.remaining > 0:
+            buf = source.read(min(self.remaining, shutil.COPY_BUFSIZE))
+            if not buf:
+                break
+            outputfile.write(buf)
+            self.remaining -= len(buf)
+
+    def end_headers(self):
+        if getattr(self, "etag", None):
+            self.send_header("ETag", self.etag)
+            if self.serve_ranges:
+                self.send_header("Accept-Ranges", "bytes")
+        super().end_headers()
+
+parser = argparse.ArgumentParser()
+parser.add_argument("--no-ranges", action="store_true", help="ignore Range headers")
+parser.add_argument("--max-rate", type=int, default=0, help="requests per second before answering 429")
+parser.add_argument("--delay", type=float, default=0.0, help="seconds to hold each request")
+parser.add_argument("--max-in-flight", type=int, default=0, help="concurrent requests before answering 503")
+parser.add_argument("--stall-every", type=int, default=0, help="stall every Nth request")
+parser.add_argument("--stall-seconds", type=float, default=30.0, help="how long a stalled request is held")
+args = parser.parse_args()
+Handler.serve_ranges = not args.no_ranges
+Handler.max_rate = args.max_rate
+Handler.delay = args.delay
+Handler.max_in_flight = args.max_in_flight
+Handler.stall_every = args.stall_every
+Handler.stall_seconds = args.stall_seconds
+
+# one context for the life of the server: the certificate is loaded once and
+# its session cache/tickets let clients resume instead of doing a full handshake.
+context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+context.load_cert_chain(certfile=CERT)
+
+# a kept-alive connection holds its handler, so serve each one on its own thread.
+server = http.server.ThreadingHTTPServer(("localhost", PORT), Handler)
+server.socket = context.wrap_socket(server.socket, server_side=True)
 with server:
     print("serving at port", PORT)
     server.serve_forever()